@@ -0,0 +1,174 @@
+#include "expr.hxx"
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <charconv>
+
+/*
+    Benchmarks for the expression tree passes
+
+    bench               run every benchmark
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+// Number of points each expression is evaluated at
+const size_t POINTS = 1 << 20;
+
+// Time n evaluations of a tree, one variable set per call, returns ns per evaluation
+double time_eval(Expr_Tree* tree, const std::vector<float>& xs, std::vector<float>& out) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < xs.size(); i++) {
+        tree->set_var("x", xs[i]);
+        out[i] = tree->eval();
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / xs.size();
+}
+
+// Time a single batch evaluation over every point, returns ns per evaluation
+double time_batch(Expr_Tree* tree, const std::vector<float>& xs, std::vector<float>& out) {
+    std::unordered_map<std::string, const float*> columns = {{"x", xs.data()}};
+    auto start = Clock::now();
+    tree->eval_batch(columns, xs.size(), out.data());
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / xs.size();
+}
+
+// Write a Poly node as its Horner scheme, e.g. ((3x + 2)x - 1)x + 7
+std::string horner_scheme(Expr_Node* poly) {
+    const std::vector<float>& coeffs = *poly->data.coeffs;
+    std::string x = subtree_infix(&*poly->left);
+    auto num = [](float val) {
+        char buf[64];
+        return std::string(buf, std::to_chars(buf, buf + sizeof(buf), val).ptr);
+    };
+
+    std::string out = num(coeffs.back());
+    for (size_t i = coeffs.size() - 1; i-- > 0;) {
+        if (i + 2 < coeffs.size()) out = "(" + out + ")";
+        out += x;
+        out += coeffs[i] < 0 ? " - " : " + ";
+        out += num(fabsf(coeffs[i]));
+    }
+    return out;
+}
+
+// Collect the Horner schemes of every Poly node in a subtree
+void horner_schemes(Expr_Node* node, std::vector<std::string>& out) {
+    if (node->flag == Type::Poly) {
+        out.push_back(horner_scheme(node));
+        return;
+    }
+    if (node->left != nullptr) horner_schemes(&*node->left, out);
+    if (node->right != nullptr) horner_schemes(&*node->right, out);
+}
+
+// Compare the naive tree against its Horner form
+void bench_horner(std::string expr) {
+    std::unique_ptr<Expr_Tree> naive(Parse(expr));
+    naive->load_stdlib();
+    std::unique_ptr<Expr_Tree> horner(naive->horner());
+
+    std::vector<float> xs(POINTS);
+    for (size_t i = 0; i < POINTS; i++)
+        xs[i] = -2.f + 4.f * i / POINTS;
+    std::vector<float> expected(POINTS), got(POINTS);
+
+    double naive_ns = time_eval(&*naive, xs, expected);
+    double horner_ns = time_eval(&*horner, xs, got);
+    double naive_batch_ns = time_batch(&*naive, xs, expected);
+    double horner_batch_ns = time_batch(&*horner, xs, got);
+
+    float max_err = 0;
+    for (size_t i = 0; i < POINTS; i++)
+        max_err = std::max(max_err, fabsf(expected[i] - got[i]) / std::max(1.f, fabsf(expected[i])));
+
+    std::vector<std::string> schemes{};
+    horner_schemes(&**horner->get_root(), schemes);
+
+    std::cout << expr << std::endl;
+    if (schemes.empty())
+        std::cout << "  horner:  not rewritten" << std::endl;
+    for (std::string scheme : schemes)
+        std::cout << "  horner:  " << scheme << std::endl;
+    std::cout << "  eval:    " << naive_ns << " ns -> " << horner_ns << " ns (" << naive_ns / horner_ns << "x)" << std::endl
+              << "  batch:   " << naive_batch_ns << " ns -> " << horner_batch_ns << " ns (" << naive_batch_ns / horner_batch_ns << "x)" << std::endl
+              << "  max relative error: " << max_err << std::endl;
+}
+
+// Infix serializer by recursive string concatenation, as a reference for bench_serialize
+std::string concat_infix(Expr_Node* root) {
+    switch (root->flag) {
+        case Type::Var:
+            return *root->data.id;
+        case Type::Num:
+            return std::to_string(root->data.val);
+        case Type::Fun:
+            return *root->data.id + "(" + concat_infix(&*root->left) + ")";
+        case Type::Sum:
+            return concat_infix(&*root->left) + " + " + concat_infix(&*root->right);
+        case Type::Sub:
+            return concat_infix(&*root->left) + " - " + concat_infix(&*root->right);
+        case Type::Mul:
+            return concat_infix(&*root->left) + "*" + concat_infix(&*root->right);
+        case Type::Exp:
+            return "(" + concat_infix(&*root->left) + ")^(" + concat_infix(&*root->right) + ")";
+        case Type::Div:
+            return "(" + concat_infix(&*root->left) + ")/(" + concat_infix(&*root->right) + ")";
+        default:
+            return "-" + concat_infix(&*root->left);
+    }
+}
+
+// Serialize a tree of the given number of terms, reusing one buffer across runs
+void bench_serialize(size_t terms) {
+    // chain copies of a term together, parsing one long string would mostly time the lexer
+    std::unique_ptr<Expr_Tree> term(Parse("a*sin(b) - (d/3.25 + c^2)"));
+    Expr_Node* root = copy_subtree(&**term->get_root());
+    for (size_t i = 1; i < terms; i++) {
+        root = new Expr_Node {
+            std::unique_ptr<Expr_Node>(root),
+            std::unique_ptr<Expr_Node>(copy_subtree(&**term->get_root())),
+            {},
+            i % 2 ? Type::Sub : Type::Sum
+        };
+    }
+    std::unique_ptr<Expr_Tree> tree(new Expr_Tree {root});
+
+    const int runs = 10;
+    std::string buf;
+    auto start = Clock::now();
+    for (int i = 0; i < runs; i++) {
+        buf.clear();
+        subtree_infix(root, buf, -1);
+    }
+    double infix_us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / runs;
+
+    start = Clock::now();
+    for (int i = 0; i < runs; i++) {
+        buf.clear();
+        tree->latex(2, buf);
+    }
+    double latex_us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / runs;
+
+    start = Clock::now();
+    size_t len = 0;
+    for (int i = 0; i < runs; i++)
+        len += concat_infix(root).size();
+    double concat_us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / runs;
+
+    std::cout << terms << " terms (" << buf.size() << " bytes of LaTeX)" << std::endl
+              << "  infix:   " << infix_us << " us" << std::endl
+              << "  latex:   " << latex_us << " us" << std::endl
+              << "  concat:  " << concat_us << " us (" << concat_us / infix_us << "x slower, " << len / runs << " bytes)" << std::endl;
+}
+
+int main(void) {
+    bench_horner("3x^4 + 2x^3 - x^2 + 5x + 7");
+    bench_horner("(x^3 - 2x + 1)/(x^2 + 1)");
+    bench_horner("sin(x^5 - 4x^3 + x) + 1");
+    // trees are chains of terms, recursion depth grows with the number of terms
+    bench_serialize(1000);
+    bench_serialize(5000);
+    bench_serialize(20000);
+}
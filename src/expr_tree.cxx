@@ -1,9 +1,22 @@
 #include <iostream>
 #include <math.h>
-#include <sstream>
-#include <iomanip>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include <charconv>
 #include "expr_tree.hxx"
 
+// Highest degree the Horner pass will expand a polynomial to
+const size_t MAX_POLY_DEGREE = 32;
+
+// Evaluate a polynomial in Horner form with fused multiply-adds
+inline float horner_eval(const std::vector<float>& coeffs, float x) {
+    float acc = coeffs.back();
+    for (size_t i = coeffs.size() - 1; i-- > 0;)
+        acc = fmaf(acc, x, coeffs[i]);
+    return acc;
+}
+
 float Expr_Tree::eval_(Expr_Node* node) {
     switch (node->flag) {
         case Type::Num:
@@ -36,6 +49,8 @@ float Expr_Tree::eval_(Expr_Node* node) {
                 exit(-1);
             }
             return this->fns[*node->data.id](this->eval_(&*node->left));
+        case Type::Poly:
+            return horner_eval(*node->data.coeffs, this->eval_(&*node->left));
         default:
             std::cerr << "Invalid flag on node. (" << node->flag << ")" << std::endl;
             exit(-1);
@@ -46,63 +61,324 @@ float Expr_Tree::eval() {
     return this->eval_(&*this->root);
 }
 
-std::string Expr_Tree::latex_(Expr_Node* node, int decimals) {
-    std::stringstream ss;
+void Expr_Tree::eval_batch_(Expr_Node* node, const std::unordered_map<std::string, const float*>& columns, size_t n, float* out) {
+    // scratch buffer for the right operand of binary operations, the left operand is evaluated in place
+    std::vector<float> rhs;
+    function f;
+
     switch (node->flag) {
-        case Type::Var:
-            return *node->data.id;
         case Type::Num:
-            ss << std::fixed << std::setprecision(decimals) << node->data.val;
-            return ss.str();
+            std::fill(out, out + n, node->data.val);
+            return;
+        case Type::Var:
+            if (columns.find(*node->data.id) != columns.end()) {
+                const float* col = columns.at(*node->data.id);
+                std::copy(col, col + n, out);
+                return;
+            }
+            // not bound to a column, broadcast the scalar value
+            std::fill(out, out + n, this->eval_(node));
+            return;
+        case Type::Neg:
+            this->eval_batch_(&*node->left, columns, n, out);
+            for (size_t i = 0; i < n; i++) out[i] = -out[i];
+            return;
+        case Type::Fun:
+            if (this->fns.find(*node->data.id) == this->fns.end()) {
+                std::cerr << "Function " << *node->data.id <<  " undefined " << std::endl;
+                exit(-1);
+            }
+            // look the function up once for the entire batch
+            f = this->fns[*node->data.id];
+            this->eval_batch_(&*node->left, columns, n, out);
+            for (size_t i = 0; i < n; i++) out[i] = f(out[i]);
+            return;
+        case Type::Poly:
+            this->eval_batch_(&*node->left, columns, n, out);
+            for (size_t i = 0; i < n; i++) out[i] = horner_eval(*node->data.coeffs, out[i]);
+            return;
         case Type::Sum:
-            return this->latex_(&*node->left, decimals) + " + " + this->latex_(&*node->right, decimals);
         case Type::Sub:
-            return this->latex_(&*node->left, decimals) + " - " + this->latex_(&*node->right, decimals);
-        case Type::Exp:
-            return this->latex_(&*node->left, decimals) + "^{" + this->latex_(&*node->right, decimals) + "}";
         case Type::Mul:
-            return this->latex_(&*node->left, decimals) + " *(" + this->latex_(&*node->right, decimals) + ")";
         case Type::Div:
-            return "\\frac{" + this->latex_(&*node->left, decimals) + "}{" + this->latex_(&*node->right, decimals) + "}";
-        case Type::Neg:
-            return "-" + this->latex_(&*node->left, decimals);
-        case Type::Fun:
-            return *node->data.id + "(" + this->latex_(&*node->left, decimals) + ")";
+        case Type::Exp:
+            rhs.resize(n);
+            this->eval_batch_(&*node->left, columns, n, out);
+            this->eval_batch_(&*node->right, columns, n, rhs.data());
+            break;
         default:
             std::cerr << "Invalid flag on node. (" << node->flag << ")" << std::endl;
             exit(-1);
     }
+
+    switch (node->flag) {
+        case Type::Sum:
+            for (size_t i = 0; i < n; i++) out[i] += rhs[i];
+            break;
+        case Type::Sub:
+            for (size_t i = 0; i < n; i++) out[i] -= rhs[i];
+            break;
+        case Type::Mul:
+            for (size_t i = 0; i < n; i++) out[i] *= rhs[i];
+            break;
+        case Type::Div:
+            for (size_t i = 0; i < n; i++) out[i] /= rhs[i];
+            break;
+        case Type::Exp:
+            for (size_t i = 0; i < n; i++) out[i] = powf(out[i], rhs[i]);
+            break;
+        default:
+            break;
+    }
 }
 
-// Compile the expression tree to LaTeX
-std::string Expr_Tree::latex(int decimals) {
-    return this->latex_(&*this->root, decimals);   
+void Expr_Tree::eval_batch(const std::unordered_map<std::string, const float*>& columns, size_t n, float* out) {
+    this->eval_batch_(&*this->root, columns, n, out);
 }
 
-std::string subtree_infix(Expr_Node* root) {
-    switch (root->flag) {
-        case Type::Var:
-            return *root->data.id;
+/*
+    Serialization
+
+    Both the LaTeX and the infix serializers append to a single output buffer, so writing a tree is linear in
+    its size. Operands are only parenthesized when PRECEDENCE/ ASSOCIATIVITY require it to keep the shape of
+    the tree:
+
+        ( - )                   ( ^ )
+        /   \                   /   \
+      ( + )  ( - )    =>      ( ^ )  z      =>  (x^y)^z
+      /  \   /  \             /  \
+     a    b c    d           x    y
+                   a + b - (c - d)
+
+    The infix output can be parsed back into the same tree.
+*/
+
+// Append a float, with a fixed number of decimals or, for a negative count, the shortest digits which read back exactly
+void append_float(std::string& out, float val, int decimals) {
+    char buf[128];
+    std::to_chars_result res = decimals < 0
+        ? std::to_chars(buf, buf + sizeof(buf), val, std::chars_format::fixed)
+        : std::to_chars(buf, buf + sizeof(buf), val, std::chars_format::fixed, decimals);
+    // too many digits for fixed notation
+    if (res.ec != std::errc())
+        res = std::to_chars(buf, buf + sizeof(buf), val);
+    out.append(buf, res.ptr);
+}
+
+// Precedence of a Poly node as written by write_poly: a sum of terms, or a single term c x^k
+uint8_t poly_precedence(const std::vector<float>& coeffs) {
+    size_t terms = 0, k = 0;
+    for (size_t i = 0; i < coeffs.size(); i++) {
+        if (coeffs[i] != 0) {
+            terms++;
+            k = i;
+        }
+    }
+    if (terms > 1)                      return PRECEDENCE[Type::Sum];
+    if (terms == 0)                     return UINT8_MAX;
+    // -c and -x, the negation binds tighter than anything following it
+    if (coeffs[k] < 0 && (k == 0 || (k == 1 && coeffs[k] == -1)))
+                                        return PRECEDENCE[Type::Neg];
+    // -c x^k reads as (-c) * x^k
+    if (fabsf(coeffs[k]) != 1 || coeffs[k] < 0)
+                                        return PRECEDENCE[Type::Mul];
+    if (k >= 2)                         return PRECEDENCE[Type::Exp];
+    return UINT8_MAX;
+}
+
+// Precedence of a node as written, leaves bind tighter than any operator
+uint8_t written_precedence(Expr_Node* node, bool latex) {
+    switch (node->flag) {
         case Type::Num:
-            return std::to_string(root->data.val);
+            return node->data.val < 0 ? PRECEDENCE[Type::Neg] : UINT8_MAX;
+        case Type::Poly:
+            return poly_precedence(*node->data.coeffs);
+        case Type::Div:
+            // \frac{}{} groups its operands
+            return latex ? UINT8_MAX : PRECEDENCE[Type::Div];
+        default:
+            return OPERATOR[node->flag] ? PRECEDENCE[node->flag] : UINT8_MAX;
+    }
+}
+
+// Whether an operand of parent must be parenthesized, right is false only for the left operand of a binary operator
+bool needs_parens(Type parent, Expr_Node* child, bool right, bool latex) {
+    uint8_t p = PRECEDENCE[parent];
+    uint8_t c = written_precedence(child, latex);
+    // in LaTeX the base of a power is kept visually atomic
+    if (latex && parent == Type::Exp && !right)
+        return child->flag != Type::Var && child->flag != Type::Fun && !(child->flag == Type::Num && c == UINT8_MAX);
+    if (c != p)
+        return c < p;
+    // equal precedence, the operand on the side the operator does not associate towards is grouped explicitly
+    return ASSOCIATIVITY[parent] == Assoc::LEFT ? right : !right;
+}
+
+// Whether a node is written starting with a letter or an opening parenthesis
+bool opens_with_word(Expr_Node* node, bool latex) {
+    switch (node->flag) {
+        case Type::Var:
         case Type::Fun:
-            return *root->data.id + "(" + subtree_infix(&*root->left) + ")";
+            return true;
+        case Type::Div:
+            if (latex) return false;
+            // fall through
         case Type::Sum:
-            return subtree_infix(&*root->left) + " + " + subtree_infix(&*root->right);
         case Type::Sub:
-            return subtree_infix(&*root->left) + " - " + subtree_infix(&*root->right);
         case Type::Mul:
-            return subtree_infix(&*root->left) + "" + subtree_infix(&*root->right);
         case Type::Exp:
-            return "(" + subtree_infix(&*root->left) + ")^(" + subtree_infix(&*root->right) + ")";
-        case Type::Div:
-            return "(" + subtree_infix(&*root->left) + ")/(" + subtree_infix(&*root->right) + ")";
+            return needs_parens(node->flag, &*node->left, false, latex) || opens_with_word(&*node->left, latex);
+        case Type::Poly:
+            // a leading coefficient of 1 is not written
+            for (size_t i = node->data.coeffs->size(); i-- > 1;) {
+                float c = (*node->data.coeffs)[i];
+                if (c != 0) return c == 1;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+void write_node(Expr_Node*, std::string&, int, bool);
+
+void write_operand(Type parent, Expr_Node* child, bool right, std::string& out, int decimals, bool latex) {
+    if (needs_parens(parent, child, right, latex)) {
+        out += '(';
+        write_node(child, out, decimals, latex);
+        out += ')';
+    } else {
+        write_node(child, out, decimals, latex);
+    }
+}
+
+// Write out a Poly node as a sum of terms, highest degree first
+void write_poly(Expr_Node* node, std::string& out, int decimals, bool latex) {
+    const std::vector<float>& coeffs = *node->data.coeffs;
+    bool first = true;
+    for (size_t i = coeffs.size(); i-- > 0;) {
+        float c = coeffs[i];
+        if (c == 0) continue;
+
+        if (first) { if (c < 0) out += '-'; }
+        else       out += c < 0 ? " - " : " + ";
+        // the parser reads -x^2 as (-x)^2, a leading -1 is written out in infix
+        bool leading_neg_power = first && c == -1 && i >= 2 && !latex;
+        first = false;
+
+        if (fabsf(c) != 1 || i == 0 || leading_neg_power) append_float(out, fabsf(c), decimals);
+        if (i == 0) continue;
+        // the term's coefficient is juxtaposed with the variable
+        write_operand(Type::Mul, &*node->left, true, out, decimals, latex);
+        if (i >= 2) {
+            out += latex ? "^{" : "^";
+            out += std::to_string(i);
+            if (latex) out += '}';
+        }
+    }
+    if (first) append_float(out, 0.f, decimals);
+}
+
+void write_node(Expr_Node* node, std::string& out, int decimals, bool latex) {
+    switch (node->flag) {
+        case Type::Var:
+            out += *node->data.id;
+            return;
+        case Type::Num:
+            append_float(out, node->data.val, decimals);
+            return;
+        case Type::Fun:
+            out += *node->data.id;
+            out += '(';
+            write_node(&*node->left, out, decimals, latex);
+            out += ')';
+            return;
         case Type::Neg:
-            return "-" + subtree_infix(&*root->left);
+            out += '-';
+            write_operand(Type::Neg, &*node->left, true, out, decimals, latex);
+            return;
+        case Type::Poly:
+            write_poly(node, out, decimals, latex);
+            return;
+        case Type::Div:
+            if (latex) {
+                out += "\\frac{";
+                write_node(&*node->left, out, decimals, latex);
+                out += "}{";
+                write_node(&*node->right, out, decimals, latex);
+                out += '}';
+                return;
+            }
+            break;
+        case Type::Exp:
+            if (latex) {
+                write_operand(Type::Exp, &*node->left, false, out, decimals, latex);
+                out += "^{";
+                write_node(&*node->right, out, decimals, latex);
+                out += '}';
+                return;
+            }
+            break;
+        case Type::Sum:
+        case Type::Sub:
+        case Type::Mul:
+            break;
         default:
-            std::cerr << "Invalid flag on node. (" << root->flag << ")" << std::endl;
+            std::cerr << "Invalid flag on node. (" << node->flag << ")" << std::endl;
             exit(-1);
     }
+
+    // remaining binary operators
+    write_operand(node->flag, &*node->left, false, out, decimals, latex);
+    switch (node->flag) {
+        case Type::Sum: out += " + "; break;
+        case Type::Sub: out += " - "; break;
+        case Type::Div: out += " / "; break;
+        case Type::Exp: out += '^';   break;
+        case Type::Mul:
+            // implicit multiplication (2x, (a + b)(c + d)) when the lexer reads it back as such
+            if ((isdigit(out.back()) || out.back() == ')')
+                && (needs_parens(Type::Mul, &*node->right, true, latex) || opens_with_word(&*node->right, latex))) break;
+            out += latex ? " \\cdot " : " * ";
+            break;
+        default:
+            break;
+    }
+    write_operand(node->flag, &*node->right, true, out, decimals, latex);
+}
+
+void Expr_Tree::latex_(Expr_Node* node, int decimals, std::string& out) {
+    write_node(node, out, decimals, true);
+}
+
+// Compile the expression tree to LaTeX
+std::string Expr_Tree::latex(int decimals) {
+    std::string out;
+    this->latex(decimals, out);
+    return out;
+}
+
+void Expr_Tree::latex(int decimals, std::string& out) {
+    this->latex_(&*this->root, decimals, out);
+}
+
+void subtree_infix(Expr_Node* root, std::string& out, int decimals) {
+    write_node(root, out, decimals, false);
+}
+
+std::string subtree_infix(Expr_Node* root) {
+    std::string out;
+    subtree_infix(root, out, -1);
+    return out;
+}
+
+void subtree_vars(Expr_Node* node, std::unordered_set<std::string>& out) {
+    if (node->flag == Type::Var) {
+        out.insert(*node->data.id);
+        return;
+    }
+    if (node->left != nullptr) subtree_vars(&*node->left, out);
+    if (node->right != nullptr) subtree_vars(&*node->right, out);
 }
 
 /*
@@ -145,6 +421,7 @@ bool constant_subtree(Expr_Node* node, std::unordered_map<std::string, float> co
             return true;
         case Type::Neg:
         case Type::Fun:
+        case Type::Poly:
             // a function can still be constant
             return constant_subtree(&*node->left, constants);
         case Type::Sum:
@@ -313,6 +590,7 @@ Expr_Node* Expr_Tree::simplify_(std::unique_ptr<Expr_Node>* node_ptr) {
         // Functions and Unary Operators
         case Type::Fun:
         case Type::Neg:
+        case Type::Poly:
             if (constant_subtree(&*node->left, this->constants)) {
                 return new Expr_Node {
                     nullptr, nullptr,
@@ -350,3 +628,308 @@ Expr_Tree* Expr_Tree::simplify() {
         this->fns
     };
 }
+
+/*
+    Horner Rewriting
+
+    A subtree which only depends on a single variable x, and is built from numbers, named constants,
+    +, -, *, negation, division by a constant and non negative integer powers of monomials, is a polynomial
+    in x. Powers of any other base (x - 1000)^4 are left alone, they already take a single powf call and
+    expanding them cancels catastrophically.
+    Its coefficients are collected and it is replaced by a Poly node
+
+        3x^4 + 2x^3 - x^2 + 5x + 7      =>      (((3x + 2)x - 1)x + 5)x + 7
+
+    which evaluates with one fused multiply-add per degree instead of a powf call per term.
+    A division of two such polynomials (a rational function) is rewritten into a division of two Poly nodes.
+
+    Coefficients are collected in double precision, but expanding products can still lose precision, so
+    each rewrite is checked against the original subtree: both are evaluated with a running error bound
+    (rounding_bound) at points spread over the scale of the coefficients, and the rewrite is only kept if
+    its bound is never much worse than the original's.
+*/
+
+// Unit roundoff of float
+const double FLOAT_UNIT = FLT_EPSILON / 2;
+
+bool Expr_Tree::poly_coeffs(Expr_Node* node, const std::string& x, std::vector<double>& out) {
+    std::vector<double> l, r;
+    switch (node->flag) {
+        case Type::Num:
+            out = {node->data.val};
+            return true;
+        case Type::Var:
+            if (*node->data.id == x) {
+                out = {0., 1.};
+                return true;
+            }
+            // named constants are coefficients, any other variable is not
+            if (this->constants.find(*node->data.id) == this->constants.end())
+                return false;
+            out = {this->constants[*node->data.id]};
+            return true;
+        case Type::Neg:
+            if (!this->poly_coeffs(&*node->left, x, out)) return false;
+            for (double& c : out) c = -c;
+            return true;
+        case Type::Poly:
+            if (node->left->flag != Type::Var || *node->left->data.id != x) return false;
+            out.assign(node->data.coeffs->begin(), node->data.coeffs->end());
+            return true;
+        case Type::Sum:
+        case Type::Sub:
+            if (!this->poly_coeffs(&*node->left, x, l) || !this->poly_coeffs(&*node->right, x, r)) return false;
+            out.assign(std::max(l.size(), r.size()), 0.);
+            for (size_t i = 0; i < l.size(); i++) out[i] += l[i];
+            for (size_t i = 0; i < r.size(); i++) out[i] += node->flag == Type::Sum ? r[i] : -r[i];
+            return true;
+        case Type::Mul:
+            if (!this->poly_coeffs(&*node->left, x, l) || !this->poly_coeffs(&*node->right, x, r)) return false;
+            if (l.size() + r.size() - 2 > MAX_POLY_DEGREE) return false;
+            out.assign(l.size() + r.size() - 1, 0.);
+            for (size_t i = 0; i < l.size(); i++)
+                for (size_t j = 0; j < r.size(); j++)
+                    out[i + j] += l[i] * r[j];
+            return true;
+        case Type::Div:
+            // only division by a non zero constant keeps a polynomial
+            if (!this->poly_coeffs(&*node->left, x, l) || !this->poly_coeffs(&*node->right, x, r)) return false;
+            for (size_t i = 1; i < r.size(); i++)
+                if (r[i] != 0) return false;
+            if (r[0] == 0) return false;
+            out = l;
+            for (double& c : out) c /= r[0];
+            return true;
+        case Type::Exp: {
+            if (node->right->flag != Type::Num) return false;
+            float p = node->right->data.val;
+            if (p < 0 || p > MAX_POLY_DEGREE || p != floorf(p)) return false;
+            if (!this->poly_coeffs(&*node->left, x, l)) return false;
+            // only monomials, c x^k
+            if (std::count_if(l.begin(), l.end(), [](double c) { return c != 0; }) > 1) return false;
+            if ((l.size() - 1) * (size_t) p > MAX_POLY_DEGREE) return false;
+            // repeated multiplication
+            out = {1.};
+            for (int k = 0; k < (int) p; k++) {
+                std::vector<double> prod(out.size() + l.size() - 1, 0.);
+                for (size_t i = 0; i < out.size(); i++)
+                    for (size_t j = 0; j < l.size(); j++)
+                        prod[i + j] += out[i] * l[j];
+                out = prod;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Build the node evaluating a list of coefficients in x, a constant when there is no x term
+Expr_Node* make_poly(std::vector<double> coeffs, const std::string& x) {
+    while (coeffs.size() > 1 && coeffs.back() == 0)
+        coeffs.pop_back();
+    if (coeffs.size() <= 1) {
+        return new Expr_Node {
+            nullptr, nullptr,
+            {coeffs.empty() ? 0.f : (float) coeffs[0]},
+            Type::Num
+        };
+    }
+
+    Expr_Node* var = new Expr_Node {nullptr, nullptr, {}, Type::Var};
+    var->data.id = new std::string {x};
+    Expr_Node* poly = new Expr_Node {std::unique_ptr<Expr_Node>(var), nullptr, {}, Type::Poly};
+    poly->data.coeffs = new std::vector<float>(coeffs.begin(), coeffs.end());
+    return poly;
+}
+
+// Degree of a coefficient list, ignoring zero leading coefficients
+size_t poly_degree(const std::vector<double>& coeffs) {
+    size_t n = coeffs.size();
+    while (n > 1 && coeffs[n - 1] == 0) n--;
+    return n - 1;
+}
+
+Expr_Node* Expr_Tree::poly_node(Expr_Node* node, const std::string& x) {
+    std::vector<double> coeffs, num, den;
+    // a rewrite only pays off from degree 2 onwards
+    if (this->poly_coeffs(node, x, coeffs)) {
+        if (poly_degree(coeffs) < 2) return nullptr;
+        return make_poly(coeffs, x);
+    }
+    if (node->flag == Type::Div && this->poly_coeffs(&*node->left, x, num) && this->poly_coeffs(&*node->right, x, den)) {
+        if (std::max(poly_degree(num), poly_degree(den)) < 2) return nullptr;
+        return new Expr_Node {
+            std::unique_ptr<Expr_Node>(make_poly(num, x)),
+            std::unique_ptr<Expr_Node>(make_poly(den, x)),
+            {},
+            Type::Div
+        };
+    }
+    return nullptr;
+}
+
+// Free a subtree built by poly_node together with the strings/ coefficients its nodes own
+void free_poly(Expr_Node* node) {
+    if (node->left != nullptr) free_poly(node->left.release());
+    if (node->right != nullptr) free_poly(node->right.release());
+    if (node->flag == Type::Var)  delete node->data.id;
+    if (node->flag == Type::Poly) delete node->data.coeffs;
+    delete node;
+}
+
+/*
+    Evaluate a subtree (as eval_ does) and return a bound on the absolute rounding error of the result,
+    propagating the error of the operands through every operation (a running error bound)
+
+        a + b       |e| <= e(a) + e(b) + u|r|
+        a * b       |e| <= |a|e(b) + |b|e(a) + u|r|
+        a / b       |e| <= (e(a) + |r|e(b))/|b| + u|r|
+        a^k         |e| <= |k||r|e(a)/|a| + u|r|
+
+    Poly nodes accumulate the bound of each fused multiply-add step of the Horner scheme.
+*/
+double Expr_Tree::rounding_bound(Expr_Node* node, float* value) {
+    float a, b;
+    double ea, eb;
+    switch (node->flag) {
+        case Type::Num:
+        case Type::Var:
+            *value = this->eval_(node);
+            return 0.;
+        case Type::Neg:
+            ea = this->rounding_bound(&*node->left, &a);
+            *value = -a;
+            return ea;
+        case Type::Poly: {
+            const std::vector<float>& coeffs = *node->data.coeffs;
+            float x;
+            double ex = this->rounding_bound(&*node->left, &x);
+            float acc = coeffs.back();
+            double e = 0.;
+            for (size_t i = coeffs.size() - 1; i-- > 0;) {
+                e = e * fabs(x) + fabs(acc) * ex;
+                acc = fmaf(acc, x, coeffs[i]);
+                e += FLOAT_UNIT * fabs(acc);
+            }
+            *value = acc;
+            return e;
+        }
+        case Type::Sum:
+        case Type::Sub:
+        case Type::Mul:
+        case Type::Div:
+        case Type::Exp:
+            break;
+        default:
+            // not part of a polynomial, assume a single rounding
+            *value = this->eval_(node);
+            return FLOAT_UNIT * fabs(*value);
+    }
+
+    ea = this->rounding_bound(&*node->left, &a);
+    eb = this->rounding_bound(&*node->right, &b);
+    switch (node->flag) {
+        case Type::Sum:
+            *value = a + b;
+            return ea + eb + FLOAT_UNIT * fabs(*value);
+        case Type::Sub:
+            *value = a - b;
+            return ea + eb + FLOAT_UNIT * fabs(*value);
+        case Type::Mul:
+            *value = a * b;
+            return fabs(a) * eb + fabs(b) * ea + FLOAT_UNIT * fabs(*value);
+        case Type::Div:
+            *value = a / b;
+            return (ea + fabs(*value) * eb) / fabs(b) + FLOAT_UNIT * fabs(*value);
+        default:
+            *value = powf(a, b);
+            if (a == 0) return pow(ea, b) + FLOAT_UNIT * fabs(*value);
+            return fabs(b) * fabs(*value) * ea / fabs(a) + FLOAT_UNIT * fabs(*value);
+    }
+}
+
+// Compare the rounding error of a rewritten subtree against the original's over the range of x
+bool Expr_Tree::poly_accurate(Expr_Node* original, Expr_Node* rewritten, const std::string& x) {
+    // the roots of every Poly node lie within [-scale, scale] (Cauchy's bound), and so does any cancellation
+    double scale = 1.;
+    size_t degree = 0;
+    std::vector<Expr_Node*> polys = {rewritten};
+    if (rewritten->flag == Type::Div) polys = {&*rewritten->left, &*rewritten->right};
+    for (Expr_Node* poly : polys) {
+        if (poly->flag != Type::Poly) continue;
+        const std::vector<float>& coeffs = *poly->data.coeffs;
+        degree = std::max(degree, coeffs.size() - 1);
+        for (size_t i = 0; i + 1 < coeffs.size(); i++)
+            scale = std::max(scale, 1. + fabs(coeffs[i] / coeffs.back()));
+    }
+
+    // 0 and points spaced by factors of sqrt(2) from 2^-8 up to twice the scale, on both sides
+    std::vector<float> points = {0.f};
+    for (double p = 1. / 256; p <= 2. * scale && p < FLT_MAX; p *= M_SQRT2) {
+        points.push_back((float) p);
+        points.push_back((float) -p);
+    }
+
+    bool had_var = this->vars.find(x) != this->vars.end();
+    float saved = had_var ? this->vars[x] : 0.f;
+
+    bool accurate = true;
+    for (float p : points) {
+        this->vars[x] = p;
+        float expected, got;
+        double expected_err = this->rounding_bound(original, &expected);
+        double got_err = this->rounding_bound(rewritten, &got);
+        // poles of rational functions and overflow
+        if (!isfinite(expected) || !isfinite(got)) {
+            if (isfinite(expected) != isfinite(got)) accurate = false;
+            continue;
+        }
+        // the results must agree within their bounds, and the rewrite may not be much less accurate
+        double slack = 4. * (degree + 1) * FLOAT_UNIT * fabs(expected);
+        if (fabs(expected - got) > expected_err + got_err + slack) accurate = false;
+        if (got_err > 16. * expected_err + slack) accurate = false;
+    }
+
+    if (had_var) this->vars[x] = saved;
+    else         this->vars.erase(x);
+    return accurate;
+}
+
+Expr_Node* Expr_Tree::horner_(std::unique_ptr<Expr_Node>* node_ptr) {
+    Expr_Node* node = node_ptr->get();
+
+    if (node->flag != Type::Var && node->flag != Type::Num && node->flag != Type::Poly) {
+        // only subtrees of exactly one variable (not counting named constants) can be rewritten
+        std::unordered_set<std::string> used{};
+        subtree_vars(node, used);
+        std::vector<std::string> free{};
+        for (std::string name : used) {
+            if (this->constants.find(name) == this->constants.end())
+                free.push_back(name);
+        }
+
+        if (free.size() == 1) {
+            Expr_Node* poly = this->poly_node(node, free[0]);
+            if (poly != nullptr && this->poly_accurate(node, poly, free[0]))
+                return poly;
+            if (poly != nullptr) free_poly(poly);
+        }
+    }
+
+    // otherwise look for polynomials further down the tree
+    return new Expr_Node {
+        node->left  != nullptr ? std::unique_ptr<Expr_Node>(this->horner_(&node->left))  : nullptr,
+        node->right != nullptr ? std::unique_ptr<Expr_Node>(this->horner_(&node->right)) : nullptr,
+        node->data,
+        node->flag
+    };
+}
+
+Expr_Tree* Expr_Tree::horner() {
+    return new Expr_Tree {
+        this->horner_(&this->root),
+        this->constants,
+        this->fns
+    };
+}
@@ -3,14 +3,18 @@
 #define _USE_MATH_DEFINES // For constants used in the stdlib
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <math.h>   // for STD_CONSTS/ STD_FNS
 #include <memory>
+#include <vector>
 #include "token.hxx"
 
 // Literal value can be either variable name or a numeric literal
+// Poly nodes hold their coefficients, lowest degree first
 union data_t {
     float val;
     std::string* id;
+    std::vector<float>* coeffs;
 };
 
 // Expression Tree Node
@@ -43,8 +47,13 @@ inline Expr_Node* copy_subtree(Expr_Node* root) {
 // Return a boolean indicating whether an expression is a constant. Used during simplification and differentiation
 bool constant_subtree(Expr_Node*,std::unordered_map<std::string,float>);
 
+// Collect the names of every variable referenced in a subtree
+void subtree_vars(Expr_Node*, std::unordered_set<std::string>&);
+
 // Get a subtree expression as a infix mathematical expression
 std::string subtree_infix(Expr_Node*);
+// Append a subtree as infix to a buffer, numbers are written with the given decimals (shortest exact form if negative)
+void subtree_infix(Expr_Node*, std::string&, int);
 
 // typedef for readability
 typedef float (* function)(float);
@@ -84,6 +93,11 @@ class Expr_Tree {
     // Private methods used in the expression simplifier
     Expr_Node* fold_constant_subtrees(Expr_Node*);
     Expr_Node* simplify_binary_operation(Expr_Node*);
+    // Private methods used by the Horner rewriting pass
+    bool poly_coeffs(Expr_Node*, const std::string&, std::vector<double>&);
+    Expr_Node* poly_node(Expr_Node*, const std::string&);
+    double rounding_bound(Expr_Node*, float*);
+    bool poly_accurate(Expr_Node*, Expr_Node*, const std::string&);
     public:
         Expr_Tree(Expr_Node* root) {
             this->root = std::unique_ptr<Expr_Node>(root);
@@ -122,12 +136,21 @@ class Expr_Tree {
         // Evaluates the expression
         float eval_(Expr_Node*);
         float eval();
+        // Evaluates the expression over n rows at once. Variables found in the column map read one value per row,
+        // all others are resolved through vars/ constants as in eval
+        void eval_batch_(Expr_Node*, const std::unordered_map<std::string, const float*>&, size_t, float*);
+        void eval_batch(const std::unordered_map<std::string, const float*>&, size_t, float*);
         // Compile expression to LaTeX
-        std::string latex_(Expr_Node*, int);
+        void latex_(Expr_Node*, int, std::string&);
         std::string latex(int);
+        // Append the LaTeX to a (reusable) buffer
+        void latex(int, std::string&);
         // Simplify the expression
         Expr_Node* simplify_(std::unique_ptr<Expr_Node>*);
         Expr_Tree* simplify();
+        // Rewrite polynomial/ rational subexpressions of a single variable into Horner form
+        Expr_Node* horner_(std::unique_ptr<Expr_Node>*);
+        Expr_Tree* horner();
 };
 
 #endif /* End of Expr Tree implementation*/
\ No newline at end of file
@@ -2,6 +2,15 @@
 #include <math.h>
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <charconv>
+#include <vector>
+
+// Rows evaluated per call to Expr_Tree::eval_batch
+const size_t BATCH_ROWS = 4096;
+// Size of the chunks read from the CSV file (grows only if a single line is longer)
+const size_t READ_CHUNK = 1 << 20;
 
 // Reads an expression from stdin and prints the result
 bool read_expr(void) {
@@ -19,12 +28,230 @@ bool read_expr(void) {
     return true;
 }
 
-/*      
+/*
+    Scan one CSV field starting at c, returns the start of the next field
+
+    sep is set to whether the field was terminated by a separator (so another, possibly empty, field
+    follows). [b, e) is set to the contents of the field without surrounding whitespace. A field enclosed in
+    double quotes (RFC 4180) may contain commas, the quotes are removed but escaped quotes ("") are
+    kept as is. Quoted fields spanning several lines are not supported.
+*/
+const char* next_field(const char* c, const char* end, const char** b, const char** e, bool* sep) {
+    while (c < end && (*c == ' ' || *c == '\t')) c++;
+    if (c < end && *c == '"') {
+        *b = ++c;
+        while (c < end && !(*c == '"' && (c + 1 == end || *(c + 1) != '"')))
+            c += *c == '"' ? 2 : 1;
+        *e = c;
+        // skip the closing quote and anything up to the separator
+        while (c < end && *c != ',') c++;
+    } else {
+        *b = c;
+        while (c < end && *c != ',') c++;
+        *e = c;
+        while (*e > *b && (*(*e - 1) == ' ' || *(*e - 1) == '\t')) (*e)--;
+    }
+    *sep = c < end;
+    return c < end ? c + 1 : c;
+}
+
+// Split a CSV line into its fields
+std::vector<std::string> split_header(const char* begin, const char* end) {
+    std::vector<std::string> fields{};
+    const char* c = begin;
+    const char *b, *e;
+    bool sep;
+    do {
+        c = next_field(c, end, &b, &e, &sep);
+        fields.push_back(std::string(b, e));
+    } while (sep);
+    return fields;
+}
+
+/*
+    Streams a CSV file through an expression
 
+    The expression is parsed once, header columns are bound to variables of the same name and the
+    file is read in fixed size chunks. Rows are accumulated into per column arrays of BATCH_ROWS values
+    which are evaluated at once and written to stdout, so memory use does not depend on the file size.
+    Columns which the expression does not reference are skipped without being parsed.
 */
+class CSV_Evaluator {
+    std::unique_ptr<Expr_Tree> tree;
+    // for every CSV column, the index of its batch array (-1 when the column is unused)
+    std::vector<int> column_slot;
+    // per column batches of values and the results of evaluating them
+    std::vector<std::vector<float>> columns;
+    std::vector<float> results;
+    // column name -> batch array, passed to eval_batch
+    std::unordered_map<std::string, const float*> bindings;
+    size_t rows;
+    // buffered output
+    std::string out;
+    public:
+        size_t total_rows;
+        CSV_Evaluator(std::string expr) {
+            this->tree = std::unique_ptr<Expr_Tree>(Parse(expr));
+            this->tree->load_stdlib();
+            this->results = std::vector<float>(BATCH_ROWS);
+            this->rows = 0;
+            this->total_rows = 0;
+        }
+        // Bind the header columns to the variables used in the expression
+        void header(const char* begin, const char* end) {
+            std::vector<std::string> names = split_header(begin, end);
+            std::unordered_set<std::string> used{};
+            subtree_vars(&**this->tree->get_root(), used);
+
+            for (std::string name : names) {
+                if (used.find(name) == used.end() || this->bindings.find(name) != this->bindings.end()) {
+                    this->column_slot.push_back(-1);
+                    continue;
+                }
+                this->column_slot.push_back(this->columns.size());
+                this->columns.push_back(std::vector<float>(BATCH_ROWS));
+                this->bindings[name] = nullptr;
+            }
+            // resolve the arrays only once they will no longer move
+            for (size_t i = 0; i < names.size(); i++) {
+                if (this->column_slot[i] >= 0)
+                    this->bindings[names[i]] = this->columns[this->column_slot[i]].data();
+            }
+        }
+        // Parse one data row into the current batch
+        void row(const char* begin, const char* end) {
+            const char* c = begin;
+            const char *field, *field_end;
+            bool sep;
+            for (size_t col = 0; col < this->column_slot.size(); col++) {
+                c = next_field(c, end, &field, &field_end, &sep);
+                int slot = this->column_slot[col];
+                if (slot < 0)
+                    continue;
+                // a leading '+' is not accepted by from_chars
+                if (field < field_end && *field == '+') field++;
+                float val;
+                std::from_chars_result res = std::from_chars(field, field_end, val);
+                // the whole field must be a number
+                if (res.ec != std::errc() || res.ptr != field_end)
+                    val = NAN;
+                this->columns[slot][this->rows] = val;
+            }
+
+            if (++this->rows == BATCH_ROWS)
+                this->flush();
+        }
+        // Evaluate the current batch and write its results
+        void flush() {
+            if (this->rows == 0)
+                return;
+            this->tree->eval_batch(this->bindings, this->rows, this->results.data());
+
+            char buf[32];
+            for (size_t i = 0; i < this->rows; i++) {
+                char* e = std::to_chars(buf, buf + sizeof(buf) - 1, this->results[i]).ptr;
+                *e++ = '\n';
+                this->out.append(buf, e);
+            }
+            fwrite(this->out.data(), 1, this->out.size(), stdout);
+            this->out.clear();
+
+            this->total_rows += this->rows;
+            this->rows = 0;
+        }
+};
+
+// Evaluate an expression for every row of a CSV file, returns the process exit code
+int eval_csv(std::string expr, std::string path) {
+    FILE* file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        std::cerr << "Could not open " << path << std::endl;
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    CSV_Evaluator evaluator(expr);
+    std::vector<char> buf(READ_CHUNK);
+    // number of bytes at the start of buf belonging to an unfinished line
+    size_t pending = 0;
+    size_t total_bytes = 0;
+    bool have_header = false;
+    bool eof = false;
+
+    while (!eof) {
+        if (pending == buf.size())
+            buf.resize(buf.size() * 2);
+        size_t n = fread(buf.data() + pending, 1, buf.size() - pending, file);
+        total_bytes += n;
+        eof = n == 0;
+
+        const char* begin = buf.data();
+        const char* end = buf.data() + pending + n;
+        // at the end of the file, the remainder is the last line
+        const char* nl;
+        while ((nl = (const char*) memchr(begin, '\n', end - begin)) != nullptr || (eof && begin < end)) {
+            const char* line_end = nl != nullptr ? nl : end;
+            const char* next = nl != nullptr ? nl + 1 : end;
+            if (line_end > begin && *(line_end - 1) == '\r') line_end--;
+
+            if (line_end > begin) {
+                if (have_header) {
+                    evaluator.row(begin, line_end);
+                } else {
+                    evaluator.header(begin, line_end);
+                    have_header = true;
+                }
+            }
+            begin = next;
+        }
+        // move the unfinished line to the start of the buffer
+        pending = end - begin;
+        memmove(buf.data(), begin, pending);
+    }
+    evaluator.flush();
+    fflush(stdout);
+
+    if (file != stdin)
+        fclose(file);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double mb = total_bytes / 1e6;
+    std::cerr << evaluator.total_rows << " rows, " << mb << " MB in " << elapsed.count() << " s ("
+              << mb / elapsed.count() << " MB/s)" << std::endl;
+
+    return 0;
+}
+
+/*
+    repl                            interactive mode
+    repl --expr <expr> --csv <file> evaluate expr for every row of a CSV file ('-' reads stdin)
+*/
+
+int main(int argc, char** argv) {
+    std::string expr, csv;
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--expr") != 0 && strcmp(argv[i], "--csv") != 0) {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return -1;
+        }
+        if (i + 1 == argc) {
+            std::cerr << "Missing value for " << argv[i] << std::endl;
+            return -1;
+        }
+        if (strcmp(argv[i], "--expr") == 0) expr = argv[i + 1];
+        else                                csv = argv[i + 1];
+    }
+
+    if (argc > 1) {
+        if (expr.empty() || csv.empty()) {
+            std::cerr << "usage: repl [--expr <expr> --csv <file>]" << std::endl;
+            return -1;
+        }
+        return eval_csv(expr, csv);
+    }
 
-int main(void) {
     while (read_expr()) {
         // lol
     }
-}
\ No newline at end of file
+}
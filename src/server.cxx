@@ -0,0 +1,531 @@
+#include "expr.hxx"
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <sstream>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/*
+    Local evaluation server
+
+    Listens on a Unix domain socket and speaks a line based protocol, one reply line per request line:
+
+        compile <expr>              -> id <n>           (identical expressions share an id)
+        eval <id> [name=value ...]  -> <result>
+        stats                       -> latency percentiles and throughput counters
+        anything else               -> error <message>
+
+    All clients share a single catalogue of parsed expressions. The I/O core is a poll() event loop,
+    eval requests read during one iteration of the loop are not answered right away but queued per
+    expression. Once every ready socket has been read the queues are flushed, each one evaluated as a
+    single batch with Expr_Tree::eval_batch.
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+// Number of latency samples kept for the percentiles
+const size_t LATENCY_SAMPLES = 1 << 16;
+// Longest request line accepted, clients exceeding it are disconnected
+const size_t MAX_LINE = 1 << 16;
+// Longest expression accepted by compile, the lexer takes quadratic time in the length of its input
+const size_t MAX_EXPR = 2048;
+// Deepest expression tree accepted by compile, the tree is built and evaluated recursively
+const size_t MAX_DEPTH = 256;
+
+// A reply slot, replies are written in the order the requests were received
+struct Reply {
+    bool ready;
+    std::string text;
+};
+
+struct Client {
+    int fd;
+    // bytes received which do not form a complete line yet
+    std::string in;
+    // bytes waiting to be sent
+    std::string out;
+    std::deque<Reply> replies;
+    // stop reading and disconnect once the pending replies are written (set on EOF)
+    bool hangup;
+    bool closed;
+};
+
+// A compiled expression in the catalogue
+struct Compiled {
+    std::unique_ptr<Expr_Tree> tree;
+    // variables referenced by the expression, excluding standard library constants
+    std::vector<std::string> vars;
+};
+
+// An eval request waiting for its expression's batch
+struct Pending {
+    Reply* reply;
+    // values in the order of Compiled::vars
+    std::vector<float> values;
+    Clock::time_point received;
+};
+
+class Server {
+    int listener;
+    std::vector<std::unique_ptr<Client>> clients;
+    std::vector<Compiled> catalogue;
+    std::unordered_map<std::string, size_t> catalogue_ids;
+    // pending eval requests, indexed by expression id
+    std::vector<std::vector<Pending>> queues;
+    // stats requests, answered after the queues are flushed so they include the current batches
+    std::vector<Reply*> pending_stats;
+    // ring buffer of request latencies in microseconds
+    std::vector<double> latencies;
+    size_t latency_next;
+    // counters
+    Clock::time_point started;
+    uint64_t requests;
+    uint64_t evals;
+    uint64_t batches;
+    uint64_t max_batch;
+
+    void accept_clients();
+    void read_client(Client*);
+    void write_client(Client*);
+    void handle_line(Client*, std::string);
+    std::string compile(std::string);
+    std::string queue_eval(Reply*, std::string);
+    std::string stats();
+    void flush_queues();
+    void record_latency(Clock::time_point);
+    public:
+        Server(int listener) {
+            this->listener = listener;
+            this->latency_next = 0;
+            this->started = Clock::now();
+            this->requests = 0;
+            this->evals = 0;
+            this->batches = 0;
+            this->max_batch = 0;
+        }
+        // Run the event loop, does not return
+        void run();
+};
+
+/*
+    The lexer and parser exit (or assert) on malformed expressions, which would take the server down for
+    every client. An expression is only handed to construct_tree once it is known to be well formed:
+
+        - it is at most MAX_EXPR characters long
+        - it only contains characters the lexer understands, numbers have at most one decimal point and
+          are in the range std::stof accepts
+        - parentheses are balanced
+        - simulating construct_tree's node stack over the postfix output never underflows, ends with
+          exactly one node and never builds a tree deeper than MAX_DEPTH
+*/
+std::string validate_expr(std::string expr) {
+    if (expr.size() > MAX_EXPR)
+        return "error expression longer than " + std::to_string(MAX_EXPR) + " characters";
+
+    int depth = 0;
+    for (size_t i = 0; i < expr.size(); i++) {
+        char c = expr[i];
+        if (isdigit(c)) {
+            // skip a numeric literal the way Lexer::consume_number reads it
+            while (i + 1 < expr.size() && isdigit(expr[i + 1])) i++;
+            if (i + 1 < expr.size() && expr[i + 1] == '.') {
+                i++;
+                while (i + 1 < expr.size() && isdigit(expr[i + 1])) i++;
+            }
+            continue;
+        }
+        if (c == '(') depth++;
+        if (c == ')' && --depth < 0) break;
+        // strchr also matches the terminator
+        if (c == '\0' || (!isalpha(c) && !strchr(" \t\r+-*/^()", c)))
+            return std::string("error unexpected character ") + (isprint(c) ? c : '?');
+    }
+    if (depth != 0)
+        return "error unbalanced parentheses";
+
+    // depth of every subtree on the node stack
+    std::vector<size_t> stack{};
+    size_t top;
+    for (Token t : ShuntingYard(expr)) {
+        switch (t.flag) {
+            case Type::Num:
+                // construct_tree uses std::stof, which throws where strtof reports ERANGE (including subnormals)
+                errno = 0;
+                strtof(t.lexeme.c_str(), nullptr);
+                if (errno == ERANGE)
+                    return "error invalid number " + t.lexeme;
+                stack.push_back(1);
+                break;
+            case Type::Var:
+                stack.push_back(1);
+                break;
+            case Type::Fun:
+            case Type::Neg:
+                if (stack.size() < 1)
+                    return "error missing operand for " + t.lexeme;
+                stack.back()++;
+                break;
+            case Type::Sum:
+            case Type::Sub:
+            case Type::Mul:
+            case Type::Div:
+            case Type::Exp:
+                if (stack.size() < 2)
+                    return "error missing operand for " + t.lexeme;
+                top = stack.back();
+                stack.pop_back();
+                stack.back() = std::max(stack.back(), top) + 1;
+                break;
+            default:
+                return "error unexpected token " + t.lexeme;
+        }
+        if (stack.back() > MAX_DEPTH)
+            return "error expression nested deeper than " + std::to_string(MAX_DEPTH);
+    }
+    if (stack.size() == 0)
+        return "error empty expression";
+    if (stack.size() != 1)
+        return "error missing operator";
+    return "";
+}
+
+// Return false if the tree calls a function the standard library does not define
+bool known_functions(Expr_Node* node) {
+    if (node == nullptr)
+        return true;
+    if (node->flag == Type::Fun && STD_FNS.find(*node->data.id) == STD_FNS.end())
+        return false;
+    return known_functions(&*node->left) && known_functions(&*node->right);
+}
+
+// Format a float into a reply string
+std::string format_float(float val) {
+    char buf[32];
+    return std::string(buf, std::to_chars(buf, buf + sizeof(buf), val).ptr);
+}
+
+std::string Server::compile(std::string expr) {
+    if (this->catalogue_ids.find(expr) != this->catalogue_ids.end())
+        return "id " + std::to_string(this->catalogue_ids[expr]);
+
+    std::string error = validate_expr(expr);
+    if (!error.empty())
+        return error;
+
+    Expr_Node* root = construct_tree(expr);
+
+    Compiled compiled{std::unique_ptr<Expr_Tree>(new Expr_Tree {root}), {}};
+    if (!known_functions(root))
+        return "error undefined function";
+    compiled.tree->load_stdlib();
+
+    std::unordered_set<std::string> used{};
+    subtree_vars(root, used);
+    for (std::string name : used) {
+        if (STD_CONSTS.find(name) == STD_CONSTS.end())
+            compiled.vars.push_back(name);
+    }
+    std::sort(compiled.vars.begin(), compiled.vars.end());
+
+    size_t id = this->catalogue.size();
+    this->catalogue.push_back(std::move(compiled));
+    this->queues.push_back({});
+    this->catalogue_ids[expr] = id;
+    return "id " + std::to_string(id);
+}
+
+// Queue an eval request, returns an error message if the request is invalid
+std::string Server::queue_eval(Reply* reply, std::string args) {
+    std::stringstream ss(args);
+    size_t id;
+    if (!(ss >> id) || id >= this->catalogue.size())
+        return "error unknown expression id";
+
+    Compiled& compiled = this->catalogue[id];
+    Pending pending{reply, std::vector<float>(compiled.vars.size(), NAN), Clock::now()};
+    std::vector<bool> seen(compiled.vars.size(), false);
+
+    std::string binding;
+    while (ss >> binding) {
+        size_t eq = binding.find('=');
+        if (eq == std::string::npos)
+            return "error expected name=value, got " + binding;
+        std::string name = binding.substr(0, eq);
+        auto it = std::lower_bound(compiled.vars.begin(), compiled.vars.end(), name);
+        // variables the expression does not use are ignored
+        if (it == compiled.vars.end() || *it != name)
+            continue;
+
+        const char* begin = binding.data() + eq + 1;
+        const char* end = binding.data() + binding.size();
+        if (begin < end && *begin == '+') begin++;
+        size_t index = it - compiled.vars.begin();
+        auto res = std::from_chars(begin, end, pending.values[index]);
+        if (res.ec != std::errc() || res.ptr != end)
+            return "error invalid value for " + name;
+        seen[index] = true;
+    }
+
+    for (size_t i = 0; i < seen.size(); i++) {
+        if (!seen[i])
+            return "error variable " + compiled.vars[i] + " undefined";
+    }
+
+    this->queues[id].push_back(std::move(pending));
+    return "";
+}
+
+void Server::record_latency(Clock::time_point received) {
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - received).count();
+    if (this->latencies.size() < LATENCY_SAMPLES) {
+        this->latencies.push_back(us);
+    } else {
+        this->latencies[this->latency_next] = us;
+        this->latency_next = (this->latency_next + 1) % LATENCY_SAMPLES;
+    }
+}
+
+std::string Server::stats() {
+    std::vector<double> sorted = this->latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) {
+        if (sorted.empty()) return 0.0;
+        return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+    };
+    double uptime = std::chrono::duration<double>(Clock::now() - this->started).count();
+
+    std::stringstream ss;
+    ss << "expressions=" << this->catalogue.size()
+       << " requests=" << this->requests
+       << " evals=" << this->evals
+       << " batches=" << this->batches
+       << " avg_batch=" << (this->batches ? (double) this->evals / this->batches : 0.0)
+       << " max_batch=" << this->max_batch
+       << " evals_per_s=" << this->evals / uptime
+       << " p50_us=" << percentile(0.50)
+       << " p90_us=" << percentile(0.90)
+       << " p99_us=" << percentile(0.99)
+       << " max_us=" << (sorted.empty() ? 0.0 : sorted.back());
+    return ss.str();
+}
+
+void Server::handle_line(Client* client, std::string line) {
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    this->requests++;
+
+    client->replies.push_back(Reply{false, ""});
+    Reply* reply = &client->replies.back();
+
+    size_t space = line.find(' ');
+    std::string cmd = line.substr(0, space);
+    std::string args = space == std::string::npos ? "" : line.substr(space + 1);
+
+    if (cmd == "compile") {
+        reply->text = this->compile(args);
+    } else if (cmd == "eval") {
+        reply->text = this->queue_eval(reply, args);
+        // answered once the batch is evaluated
+        if (reply->text.empty())
+            return;
+    } else if (cmd == "stats") {
+        this->pending_stats.push_back(reply);
+        return;
+    } else {
+        reply->text = "error unknown command " + cmd;
+    }
+    reply->ready = true;
+}
+
+void Server::flush_queues() {
+    for (size_t id = 0; id < this->queues.size(); id++) {
+        std::vector<Pending>& queue = this->queues[id];
+        if (queue.empty())
+            continue;
+
+        Compiled& compiled = this->catalogue[id];
+        size_t n = queue.size();
+        // transpose the requests into one column per variable
+        std::vector<std::vector<float>> columns(compiled.vars.size(), std::vector<float>(n));
+        std::unordered_map<std::string, const float*> bindings{};
+        for (size_t v = 0; v < compiled.vars.size(); v++) {
+            for (size_t i = 0; i < n; i++)
+                columns[v][i] = queue[i].values[v];
+            bindings[compiled.vars[v]] = columns[v].data();
+        }
+
+        std::vector<float> results(n);
+        compiled.tree->eval_batch(bindings, n, results.data());
+
+        for (size_t i = 0; i < n; i++) {
+            queue[i].reply->text = format_float(results[i]);
+            queue[i].reply->ready = true;
+            this->record_latency(queue[i].received);
+        }
+
+        this->evals += n;
+        this->batches++;
+        this->max_batch = std::max(this->max_batch, (uint64_t) n);
+        queue.clear();
+    }
+}
+
+void Server::accept_clients() {
+    int fd;
+    while ((fd = accept(this->listener, nullptr, nullptr)) >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        this->clients.push_back(std::unique_ptr<Client>(new Client {fd, "", "", {}, false, false}));
+    }
+}
+
+void Server::read_client(Client* client) {
+    char buf[1 << 16];
+    ssize_t n;
+    while (!client->hangup && (n = read(client->fd, buf, sizeof(buf))) > 0) {
+        client->in.append(buf, n);
+
+        size_t start = 0, nl;
+        while ((nl = client->in.find('\n', start)) != std::string::npos) {
+            this->handle_line(client, client->in.substr(start, nl - start));
+            start = nl + 1;
+        }
+        client->in.erase(0, start);
+
+        // the remainder can never become a valid request
+        if (client->in.size() > MAX_LINE) {
+            client->replies.push_back(Reply{true, "error line too long"});
+            client->in.clear();
+            client->hangup = true;
+        }
+    }
+    if (client->hangup)
+        return;
+    if (n == 0) {
+        // the client is done sending, answer what it sent (including an unterminated last line) and hang up
+        if (!client->in.empty())
+            this->handle_line(client, client->in);
+        client->in.clear();
+        client->hangup = true;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        client->closed = true;
+    }
+}
+
+void Server::write_client(Client* client) {
+    // move the replies which are ready, in order, to the output buffer
+    while (!client->replies.empty() && client->replies.front().ready) {
+        client->out += client->replies.front().text;
+        client->out += '\n';
+        client->replies.pop_front();
+    }
+
+    while (!client->out.empty()) {
+        ssize_t n = send(client->fd, client->out.data(), client->out.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                client->closed = true;
+            break;
+        }
+        client->out.erase(0, n);
+    }
+}
+
+void Server::run() {
+    std::vector<pollfd> fds;
+    while (true) {
+        fds.clear();
+        fds.push_back(pollfd{this->listener, POLLIN, 0});
+        for (auto& client : this->clients) {
+            short events = client->hangup ? 0 : POLLIN;
+            if (!client->out.empty()) events |= POLLOUT;
+            fds.push_back(pollfd{client->fd, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "poll: " << strerror(errno) << std::endl;
+            exit(-1);
+        }
+
+        // read every ready socket before evaluating, so concurrent requests share a batch
+        size_t connected = this->clients.size();
+        for (size_t i = 0; i < connected; i++) {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+                this->read_client(&*this->clients[i]);
+        }
+        if (fds[0].revents & POLLIN)
+            this->accept_clients();
+
+        this->flush_queues();
+        for (Reply* reply : this->pending_stats) {
+            reply->text = this->stats();
+            reply->ready = true;
+        }
+        this->pending_stats.clear();
+
+        for (auto& client : this->clients) {
+            if (client->closed)
+                continue;
+            this->write_client(&*client);
+            if (client->hangup && client->out.empty() && client->replies.empty())
+                client->closed = true;
+        }
+
+        // drop disconnected clients only now, pending replies point into them
+        for (size_t i = 0; i < this->clients.size();) {
+            if (this->clients[i]->closed) {
+                close(this->clients[i]->fd);
+                this->clients.erase(this->clients.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: server <socket path>" << std::endl;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << argv[1] << std::endl;
+        return -1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    // replace a stale socket from a previous run, but never anything else
+    struct stat st;
+    if (lstat(argv[1], &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cerr << argv[1] << " exists and is not a socket" << std::endl;
+            return -1;
+        }
+        unlink(argv[1]);
+    }
+
+    if (fd < 0 || bind(fd, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        std::cerr << "Could not listen on " << argv[1] << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::cerr << "Listening on " << argv[1] << std::endl;
+    Server(fd).run();
+}
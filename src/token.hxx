@@ -8,6 +8,7 @@ enum Type {
     Num, Var, Fun,  // numeric literal, variable, function
     lp, rp, // left and right parentheses
     Sum, Sub, Div, Mul, Exp, Neg, // Operators
+    Poly, // polynomial in Horner form, only created by Expr_Tree::horner
 };
 
 // Enumerated type for the associativity of an operator
@@ -18,15 +19,15 @@ enum Assoc {
 };
 
 // Lookup table for printing Types as strings
-const std::string TYPE_STR[11] = {
+const std::string TYPE_STR[12] = {
     "Num", "Var", "Fun",
     "lp", "rp", "Sum",
     "Sub", "Div", "Mul",
-    "Exp", "Neg"
+    "Exp", "Neg", "Poly"
 };
 
 // Lookup table to get the precedence of an implemented Operator
-const uint8_t PRECEDENCE[11] = {
+const uint8_t PRECEDENCE[12] = {
     // Not operators
     0, 0, 0, 
     0, 0,
@@ -37,10 +38,12 @@ const uint8_t PRECEDENCE[11] = {
     3, 3, // Division, Multiplication
     4,    // Exponentiation
     5,    // Unary Negation
+
+    0,    // Poly
 };
 
 // Lookup table for the associativity of an operator
-const Assoc ASSOCIATIVITY[11] = {
+const Assoc ASSOCIATIVITY[12] = {
     // Not operators
     Assoc::NONE, Assoc::NONE, Assoc::NONE,
     Assoc::NONE, Assoc::NONE,
@@ -48,17 +51,21 @@ const Assoc ASSOCIATIVITY[11] = {
     // Operators
     Assoc::LEFT, Assoc::LEFT, // Addition, Subtraction
     Assoc::LEFT, Assoc::LEFT, // Division, Multiplication
-    Assoc::RIGHT, Assoc::RIGHT// Exponentiation, Unary Negation
+    Assoc::RIGHT, Assoc::RIGHT,// Exponentiation, Unary Negation
+
+    Assoc::NONE, // Poly
 };
 
 // Lookup table for telling if a flag is an operator
-const bool OPERATOR[11] = {
+const bool OPERATOR[12] = {
     false, false, false,
     false, false,
 
     true, true,
     true, true,
-    true, true
+    true, true,
+
+    false
 };
 
 struct Token {